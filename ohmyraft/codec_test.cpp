@@ -0,0 +1,451 @@
+// Round trips every kind of op through the AppendEntries format
+// (EntryWire) and its cache, and both log record formats (LogCodec),
+// checks that broken input is turned away, that a log written in record
+// format 1 comes back the same after its segments are upgraded, that a
+// torn log tail is cut off on startup while a bad segment header stops
+// it, and that entries not released yet are kept in memory as they were
+// appended.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <functional>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "ConsensusUtils.H"
+#include "EntryWire.H"
+#include "LogCodec.H"
+#include "SegmentedLog.H"
+
+using namespace raft;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if ( ! ( cond ) ) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+      ++failures; \
+    } \
+  } while ( 0 )
+
+static RaftOp makeOp( RaftOp::OpType kind, RaftOp::arg_t args )
+{
+  return RaftOp {
+    .kind = kind,
+    .args = args,
+    .promiseHandle = {}
+  };
+}
+
+static RaftOp makeBatch( std::vector<RaftOp::putarg_t> pairs )
+{
+  auto op = makeOp( RaftOp::BATCH_PUT, static_cast<RaftOp::getarg_t>( pairs.size() ) );
+  op.batch = std::make_shared<std::vector<RaftOp::putarg_t>>( std::move( pairs ) );
+  return op;
+}
+
+static ServerInfo makeServer( int id, const char* ip, const char* name )
+{
+  ServerInfo info {};
+  info.id = id;
+  info.raft_port = 50050 + id;
+  info.db_port = 60060 + id;
+  std::strncpy( info.ip, ip, sizeof(info.ip) - 1 );
+  std::strncpy( info.name, name, sizeof(info.name) - 1 );
+  return info;
+}
+
+static bool sameOp( const RaftOp& a, const RaftOp& b )
+{
+  if ( a.kind != b.kind ) {
+    return false;
+  }
+  switch ( a.kind ) {
+    case RaftOp::GET:
+    case RaftOp::REMOVE_SERVER:
+      return std::get<RaftOp::getarg_t>( a.args ) == std::get<RaftOp::getarg_t>( b.args );
+    case RaftOp::PUT:
+      return std::get<RaftOp::putarg_t>( a.args ) == std::get<RaftOp::putarg_t>( b.args );
+    case RaftOp::ADD_SERVER: {
+      auto& x = std::get<RaftOp::addserverarg_t>( a.args );
+      auto& y = std::get<RaftOp::addserverarg_t>( b.args );
+      return x.id == y.id && x.raft_port == y.raft_port && x.db_port == y.db_port &&
+             std::strcmp( x.ip, y.ip ) == 0 && std::strcmp( x.name, y.name ) == 0;
+    }
+    case RaftOp::BATCH_PUT:
+      return a.batch && b.batch && *a.batch == *b.batch &&
+             std::get<RaftOp::getarg_t>( a.args ) == std::get<RaftOp::getarg_t>( b.args );
+  }
+  return false;
+}
+
+// Every kind, with negative and extreme keys and values, and terms that go
+// up, stay put and jump
+static std::vector<LogEntry> sampleEntries()
+{
+  return {
+    { 1, makeOp( RaftOp::GET, 0 ) },
+    { 1, makeOp( RaftOp::GET, -1 ) },
+    { 2, makeOp( RaftOp::GET, INT_MIN ) },
+    { 2, makeOp( RaftOp::PUT, std::make_pair( 7, 42 ) ) },
+    { 2, makeOp( RaftOp::PUT, std::make_pair( -300, -70000 ) ) },
+    { 9, makeOp( RaftOp::PUT, std::make_pair( INT_MAX, INT_MIN ) ) },
+    { 9, makeOp( RaftOp::ADD_SERVER, makeServer( 3, "10.0.0.3", "node3" ) ) },
+    { 10, makeOp( RaftOp::ADD_SERVER, makeServer( -2, "", "" ) ) },
+    { 10, makeOp( RaftOp::ADD_SERVER, makeServer( 4, "255.255.255.255", "a-name-of-24-characters!" ) ) },
+    { 10, makeOp( RaftOp::REMOVE_SERVER, 3 ) },
+    { 1000000, makeOp( RaftOp::REMOVE_SERVER, -5 ) },
+    { 1000000, makeBatch( { { 5, 1 }, { 3, -1 }, { -100, 0 }, { INT_MAX, INT_MAX }, { INT_MIN, 9 } } ) },
+    { 1000001, makeBatch( {} ) },
+  };
+}
+
+static void testWireRoundTrip()
+{
+  auto entries = sampleEntries();
+  for ( int32_t prevTerm : { 0, 1, 5, 2000000 } ) {
+    std::string wire;
+    auto term = prevTerm;
+    for ( auto& entry : entries ) {
+      EntryWire::encode( entry, term, wire );
+      term = entry.term;
+    }
+    EntryWire::entries_t out;
+    CHECK( EntryWire::decode( wire.data(), wire.size(), 99, prevTerm, out ) );
+    CHECK( out.size() == entries.size() );
+    for ( size_t i = 0; i < std::min( out.size(), entries.size() ); ++i ) {
+      CHECK( out[i].index == 100 + static_cast<int32_t>( i ) );
+      CHECK( out[i].term == entries[i].term );
+      CHECK( sameOp( out[i].op, entries[i].op ) );
+    }
+  }
+
+  // a GET of a small key is two bytes when the term doesn't change
+  std::string small;
+  EntryWire::encode( LogEntry { 4, makeOp( RaftOp::GET, 5 ) }, 4, small );
+  CHECK( small.size() == 2 );
+}
+
+static void testWireRejectsBrokenInput()
+{
+  auto entries = sampleEntries();
+  for ( auto& entry : entries ) {
+    std::string wire;
+    EntryWire::encode( entry, 0, wire );
+    // every strict prefix of a single entry is cut short somewhere
+    for ( size_t len = 1; len < wire.size(); ++len ) {
+      EntryWire::entries_t out;
+      CHECK( ! EntryWire::decode( wire.data(), len, 0, 0, out ) );
+    }
+  }
+
+  auto rejects = []( std::string wire ) {
+    EntryWire::entries_t out;
+    return ! EntryWire::decode( wire.data(), wire.size(), 0, 0, out );
+  };
+  // unknown op kinds
+  CHECK( rejects( std::string( 1, '\x05' ) + '\x02' ) );
+  CHECK( rejects( std::string( 1, '\x7f' ) + '\x02' ) );
+  // a varint that never ends
+  CHECK( rejects( std::string( 1, '\x00' ) + std::string( 11, '\xff' ) ) );
+  // a term change with no delta
+  CHECK( rejects( std::string( 1, '\x80' ) ) );
+  // a batch claiming more pairs than there are bytes for
+  CHECK( rejects( std::string( 1, '\x04' ) + '\x7f' + '\x02' + '\x02' ) );
+  // ADD_SERVER with an ip that doesn't fit ServerInfo::ip
+  std::string addServer( 1, '\x02' );
+  putSignedVarint( addServer, 1 );
+  putSignedVarint( addServer, 2 );
+  putSignedVarint( addServer, 3 );
+  putVarint( addServer, sizeof(ServerInfo::ip) );
+  addServer.append( sizeof(ServerInfo::ip), '1' );
+  putVarint( addServer, 0 );
+  CHECK( rejects( addServer ) );
+  // ... and one whose name runs past the end
+  std::string shortName( 1, '\x02' );
+  putSignedVarint( shortName, 1 );
+  putSignedVarint( shortName, 2 );
+  putSignedVarint( shortName, 3 );
+  putVarint( shortName, 0 );
+  putVarint( shortName, 4 );
+  shortName.append( "abc" );
+  CHECK( rejects( shortName ) );
+
+  // nothing at all is no entries
+  EntryWire::entries_t out;
+  CHECK( EntryWire::decode( nullptr, 0, 0, 0, out ) && out.empty() );
+}
+
+// The cache keeps a window of the newest entries, what it hands out is
+// what encoding them from scratch gives
+static void testWireCacheWindow()
+{
+  std::vector<RaftOp::putarg_t> pairs;
+  for ( int i = 0; i < ( 1 << 16 ); ++i ) {
+    pairs.push_back( { i, INT_MAX - i } );
+  }
+  auto big = LogEntry { 1, makeBatch( pairs ) };
+
+  EntryWireCache cache;
+  cache.reset( 10, 0 );
+  std::string one;
+  EntryWire::encode( big, 1, one );
+  int32_t n = 0;
+  while ( cache.begin() == 10 ) {
+    cache.append( big );
+    ++n;
+    CHECK( cache.bytes() <= 2 * WIRE_CACHE_BYTES + one.size() );
+  }
+  CHECK( cache.end() == 10 + n );
+  CHECK( cache.bytes() <= WIRE_CACHE_BYTES );
+  CHECK( cache.bytes() + one.size() > WIRE_CACHE_BYTES );
+
+  std::string out;
+  CHECK( ! cache.copy( cache.begin() - 1, cache.end(), out ) && out.empty() );
+  CHECK( cache.copy( cache.begin(), cache.begin() + 2, out ) );
+  // the first entry of the window is still relative to the one before
+  CHECK( out == one + one );
+}
+
+template <class Codec>
+static void testRecordRoundTrip()
+{
+  for ( auto& entry : sampleEntries() ) {
+    std::string record;
+    Codec::encode( entry, record );
+    LogEntry back;
+    CHECK( Codec::decode( record.data(), record.size(), back, Codec::Version ) );
+    CHECK( back.term == entry.term );
+    CHECK( sameOp( back.op, entry.op ) );
+    // records are framed, so anything short or trailing is corrupt
+    CHECK( ! Codec::decode( record.data(), record.size() - 1, back, Codec::Version ) );
+    record.push_back( '\0' );
+    CHECK( ! Codec::decode( record.data(), record.size(), back, Codec::Version ) );
+  }
+}
+
+static void testRecordVersions()
+{
+  // the current codec still reads format 1 records, and turns away
+  // versions it doesn't know
+  for ( auto& entry : sampleEntries() ) {
+    std::string record;
+    LogEntryImageCodec::encode( entry, record );
+    LogEntry back;
+    CHECK( LogEntryCodec::decode( record.data(), record.size(), back, LogEntryImageCodec::Version ) );
+    CHECK( back.term == entry.term );
+    CHECK( sameOp( back.op, entry.op ) );
+    CHECK( ! LogEntryCodec::decode( record.data(), record.size(), back, LogEntryCodec::Version + 1 ) );
+  }
+}
+
+static uint32_t segmentVersion( const std::string& path )
+{
+  uint32_t version = 0;
+  auto fd = open( path.c_str(), O_RDONLY );
+  if ( fd >= 0 ) {
+    if ( pread( fd, &version, sizeof(version), 4 ) != sizeof(version) ) {
+      version = 0;
+    }
+    close( fd );
+  }
+  return version;
+}
+
+static void testSegmentUpgrade()
+{
+  char dir[] = "/tmp/codec_test.XXXXXX";
+  if ( mkdtemp( dir ) == nullptr ) {
+    CHECK( ! "mkdtemp failed" );
+    return;
+  }
+  auto prefix = std::string( dir ) + "/raft.0.wal";
+  auto firstSegment = prefix + ".00000000000000000000";
+
+  auto entries = sampleEntries();
+  {
+    SegmentedLog<LogEntry, LogEntryImageCodec> old;
+    old.setup( prefix, false );
+    for ( auto& entry : entries ) {
+      old.push_back( entry );
+    }
+    old.persist();
+  }
+  CHECK( segmentVersion( firstSegment ) == LogEntryImageCodec::Version );
+
+  for ( int round = 0; round < 2; ++round ) {
+    // the first time around the segment is upgraded, the second time it
+    // is read as it is
+    SegmentedLog<LogEntry, LogEntryCodec> log;
+    log.setup( prefix, true );
+    CHECK( segmentVersion( firstSegment ) == LogEntryCodec::Version );
+    CHECK( log.size() == entries.size() );
+    for ( size_t i = 0; i < std::min( log.size(), entries.size() ); ++i ) {
+      CHECK( log[i].term == entries[i].term );
+      CHECK( sameOp( log[i].op, entries[i].op ) );
+    }
+  }
+
+  std::system( ( "rm -rf " + std::string( dir ) ).c_str() );
+}
+
+static off_t fileSize( const std::string& path )
+{
+  struct stat st;
+  return stat( path.c_str(), &st ) == 0 ? st.st_size : -1;
+}
+
+// Damages the segment of a freshly written log with breakIt, then checks
+// how many entries a restart finds and that the log still takes appends
+static void checkRecovery( const char* what, std::function<void(int fd, off_t size)> breakIt,
+                           bool expectOk, size_t expectSize )
+{
+  char dir[] = "/tmp/codec_test.XXXXXX";
+  if ( mkdtemp( dir ) == nullptr ) {
+    CHECK( ! "mkdtemp failed" );
+    return;
+  }
+  auto prefix = std::string( dir ) + "/raft.0.wal";
+  auto segment = prefix + ".00000000000000000000";
+
+  auto entries = sampleEntries();
+  {
+    SegmentedLog<LogEntry, LogEntryCodec> log;
+    log.setup( prefix, false );
+    for ( auto& entry : entries ) {
+      log.push_back( entry );
+    }
+    CHECK( log.persist() );
+  }
+  auto fd = open( segment.c_str(), O_RDWR );
+  breakIt( fd, fileSize( segment ) );
+  close( fd );
+  auto brokenSize = fileSize( segment );
+
+  {
+    SegmentedLog<LogEntry, LogEntryCodec> log;
+    auto ok = log.setup( prefix, true );
+    if ( ok != expectOk ) {
+      std::cerr << what << ": setup returned " << ok << std::endl;
+    }
+    CHECK( ok == expectOk );
+    CHECK( log.broken() == ! expectOk );
+    if ( ! ok ) {
+      // left alone for someone to look at
+      CHECK( fileSize( segment ) == brokenSize );
+      std::system( ( "rm -rf " + std::string( dir ) ).c_str() );
+      return;
+    }
+    CHECK( log.size() == expectSize );
+    for ( size_t i = 0; i < std::min( log.size(), entries.size() ); ++i ) {
+      CHECK( log[i].term == entries[i].term );
+      CHECK( sameOp( log[i].op, entries[i].op ) );
+    }
+    log.push_back( entries[0] );
+    CHECK( log.persist() );
+  }
+  {
+    SegmentedLog<LogEntry, LogEntryCodec> log;
+    CHECK( log.setup( prefix, true ) );
+    CHECK( log.size() == expectSize + 1 );
+    CHECK( segmentVersion( segment ) == LogEntryCodec::Version );
+  }
+
+  std::system( ( "rm -rf " + std::string( dir ) ).c_str() );
+}
+
+static void testSegmentRecovery()
+{
+  auto all = sampleEntries().size();
+  checkRecovery( "torn tail", []( int fd, off_t size ) {
+    CHECK( ftruncate( fd, size - 3 ) == 0 );
+  }, true, all - 1 );
+  checkRecovery( "torn record header", []( int fd, off_t size ) {
+    // a few bytes of the next record's header made it
+    CHECK( pwrite( fd, "\x10\0\0", 3, size ) == 3 );
+  }, true, all );
+  checkRecovery( "crc mismatch", []( int fd, off_t size ) {
+    char c;
+    CHECK( pread( fd, &c, 1, size - 1 ) == 1 );
+    c ^= 0x5a;
+    CHECK( pwrite( fd, &c, 1, size - 1 ) == 1 );
+  }, true, all - 1 );
+  checkRecovery( "torn header", []( int fd, off_t ) {
+    // went down while creating the segment
+    CHECK( ftruncate( fd, 6 ) == 0 );
+  }, true, 0 );
+  checkRecovery( "newer version", []( int fd, off_t ) {
+    uint32_t version = LogEntryCodec::Version + 1;
+    CHECK( pwrite( fd, &version, 4, 4 ) == 4 );
+  }, false, 0 );
+  checkRecovery( "bad magic", []( int fd, off_t ) {
+    CHECK( pwrite( fd, "XXXX", 4, 0 ) == 4 );
+  }, false, 0 );
+  checkRecovery( "wrong first index", []( int fd, off_t ) {
+    uint64_t first = 7;
+    CHECK( pwrite( fd, &first, 8, 8 ) == 8 );
+  }, false, 0 );
+}
+
+// preproc flips the sign on the way to disk, so an entry that comes back
+// negative was evicted and read back
+static void testReleaseBefore()
+{
+  char dir[] = "/tmp/codec_test.XXXXXX";
+  if ( mkdtemp( dir ) == nullptr ) {
+    CHECK( ! "mkdtemp failed" );
+    return;
+  }
+  SegmentedLog<int64_t> log;
+  log.setup( std::string( dir ) + "/raft.0.wal", false, []( int64_t val ) { return -val; } );
+  int64_t cached = WAL_CACHED_ENTRIES;
+  int64_t total = cached * 2;
+  int64_t released = cached / 2;
+  log.releaseBefore( released );
+  for ( int64_t i = 1; i <= total; ++i ) {
+    log.push_back( i );
+    if ( i % 1000 == 0 ) {
+      CHECK( log.persist() );
+    }
+  }
+  CHECK( log.persist() );
+  CHECK( log[0] == -1 );
+  CHECK( log[released - 1] == -released );
+  CHECK( log[released] == released + 1 );
+  CHECK( log[total - 1] == total );
+
+  // releasing them lets the next append drop them down to the usual size
+  log.releaseBefore( total );
+  log.push_back( total + 1 );
+  CHECK( log[released] == -( released + 1 ) );
+  CHECK( log[total - cached] == -( total - cached + 1 ) );
+  CHECK( log[total + 1 - cached] == total + 2 - cached );
+
+  std::system( ( "rm -rf " + std::string( dir ) ).c_str() );
+}
+
+int main()
+{
+  testWireRoundTrip();
+  testWireRejectsBrokenInput();
+  testWireCacheWindow();
+  testRecordRoundTrip<LogEntryImageCodec>();
+  testRecordRoundTrip<LogEntryCodec>();
+  testRecordVersions();
+  testSegmentUpgrade();
+  testSegmentRecovery();
+  testReleaseBefore();
+
+  if ( failures > 0 ) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "codec_test passed" << std::endl;
+  return 0;
+}
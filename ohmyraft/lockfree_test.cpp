@@ -0,0 +1,177 @@
+// Hammers RingQueue and PromiseStore from several threads at once, checks
+// that nothing is lost, duplicated or reordered. Most useful built with
+// -fsanitize=thread.
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <array>
+#include <future>
+#include <cstdint>
+
+#include "RingQueue.H"
+#include "PromiseStore.H"
+
+using namespace raft;
+
+static std::atomic<int> failures { 0 };
+
+#define CHECK(cond) do { \
+    if ( ! ( cond ) ) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+      ++failures; \
+    } \
+  } while ( 0 )
+
+constexpr int Producers = 4;
+constexpr int Consumers = 4;
+constexpr int PerProducer = 100000;
+
+// Values own heap memory, so that a slot read while it is being written
+// shows up as a race or a bad pointer rather than a quietly wrong number
+static void testRingQueue()
+{
+  RingQueue<std::unique_ptr<int64_t>> queue( 64 );
+  std::atomic<int64_t> popped { 0 };
+  std::vector<std::vector<int64_t>> seen( Consumers );
+
+  std::vector<std::thread> threads;
+  for ( int p = 0; p < Producers; ++p ) {
+    threads.emplace_back( [&, p] {
+      for ( int64_t i = 0; i < PerProducer; ++i ) {
+        queue.push( std::make_unique<int64_t>( p * int64_t( PerProducer ) + i ) );
+      }
+    } );
+  }
+  for ( int c = 0; c < Consumers; ++c ) {
+    threads.emplace_back( [&, c] {
+      std::unique_ptr<int64_t> val;
+      while ( popped.load() < Producers * int64_t( PerProducer ) ) {
+        if ( queue.tryPop( val ) ) {
+          seen[c].push_back( *val );
+          popped.fetch_add( 1 );
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    } );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+
+  std::vector<int> count( Producers * PerProducer, 0 );
+  for ( auto& vals : seen ) {
+    // a consumer sees the values of any one producer in the order pushed
+    std::vector<int64_t> last( Producers, -1 );
+    for ( auto v : vals ) {
+      ++count[v];
+      CHECK( v > last[v / PerProducer] );
+      last[v / PerProducer] = v;
+    }
+  }
+  for ( auto n : count ) {
+    CHECK( n == 1 );
+  }
+  CHECK( queue.size() == 0 );
+}
+
+struct AddTo {
+  std::atomic<int64_t>* sum;
+  int64_t weight;
+  void operator()( int64_t res ) { sum->fetch_add( weight * res ); }
+};
+
+// Producers insert callables and promises and hand the handles to
+// consumers, which complete them. Producers also take back some of their
+// own. Enough are in flight at once for the store to add chunks.
+static void testPromiseStore()
+{
+  using Store = PromiseStore<int64_t>;
+  auto& store = Store::Instance();
+  constexpr int Batch = 10000;
+  constexpr int Rounds = 6;
+
+  RingQueue<Store::handle_t> handles( 1 << 16 );
+  std::atomic<int64_t> completedSum { 0 };
+  std::atomic<int64_t> expectedSum { 0 };
+  std::atomic<int> producersLeft { Producers };
+
+  std::vector<std::thread> threads;
+  for ( int p = 0; p < Producers; ++p ) {
+    threads.emplace_back( [&, p] {
+      for ( int r = 0; r < Rounds; ++r ) {
+        std::vector<Store::handle_t> mine;
+        std::vector<std::future<int64_t>> futures;
+        for ( int i = 0; i < Batch; ++i ) {
+          int64_t weight = p * Batch + i + 1;
+          if ( i % 5 == 0 ) {
+            // kept back and taken again, never completed
+            mine.push_back( store.insert( AddTo { &completedSum, weight } ) );
+          } else if ( i % 5 == 1 ) {
+            std::promise<int64_t> pr;
+            futures.push_back( pr.get_future() );
+            handles.push( store.insert( std::move( pr ) ) );
+          } else if ( i % 5 == 2 ) {
+            // too big to be stored inline
+            std::array<int64_t, 16> pad {};
+            pad[15] = weight;
+            handles.push( store.insert( [&completedSum, pad]( int64_t res ) { completedSum.fetch_add( pad[15] * res ); } ) );
+            expectedSum.fetch_add( weight * 2 );
+          } else {
+            handles.push( store.insert( AddTo { &completedSum, weight } ) );
+            expectedSum.fetch_add( weight * 2 );
+          }
+        }
+        for ( auto h : mine ) {
+          auto fn = store.take<AddTo>( h );
+          CHECK( fn.sum == &completedSum );
+        }
+        for ( auto& f : futures ) {
+          CHECK( f.get() == 2 );
+        }
+      }
+      producersLeft.fetch_sub( 1 );
+    } );
+  }
+  for ( int c = 0; c < Consumers; ++c ) {
+    threads.emplace_back( [&] {
+      Store::handle_t h;
+      while ( true ) {
+        // once the producers are done everything they pushed is there
+        bool last = producersLeft.load() == 0;
+        bool any = false;
+        while ( handles.tryPop( h ) ) {
+          store.complete( h, 2 );
+          any = true;
+        }
+        if ( last ) {
+          break;
+        }
+        if ( ! any ) {
+          std::this_thread::yield();
+        }
+      }
+    } );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  CHECK( completedSum.load() == expectedSum.load() );
+  CHECK( store.size() == 0 );
+}
+
+int main()
+{
+  testRingQueue();
+  testPromiseStore();
+
+  if ( failures > 0 ) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "lockfree_test passed" << std::endl;
+  return 0;
+}
@@ -12,18 +12,22 @@
 #include "RaftService.H"
 #include "ConsensusUtils.H"
 
+// Changes the membership or the leader of one raft group, a replica with
+// several shards needs the change made in each of its groups
 class Admin {
 public:
-  Admin( std::map<int32_t, ServerInfo> servers ): servers_(servers),
-        client_( grpc::CreateChannel( "10.10.1.1:1234", grpc::InsecureChannelCredentials() ) ) {}
+  Admin( std::map<int32_t, ServerInfo> servers, int32_t group = 0 ): servers_(servers), group_(group),
+        client_( grpc::CreateChannel( "10.10.1.1:1234", grpc::InsecureChannelCredentials() ), group ) {}
 
   bool AddServer( int id, std::string ip, int db_port, int raft_port, std::string name );
   bool RemoveServer( int id );
+  bool TransferLeadership( int id );
   bool WriteConfig( std::string filename, std::map<int32_t, ServerInfo> servers );
 
 private:
   static constexpr const int32_t MAX_TRIES = 1000;
   std::map<int32_t, ServerInfo> servers_; // map of server id to server info
+  int32_t group_;
   RaftClient client_;
 
   void SwitchClient ( int server_id );
@@ -35,20 +39,20 @@ void Admin::SwitchClient ( int server_id )
     ServerInfo info = servers_[server_id];
     std::string addr = std::string(info.ip) + ":" + std::to_string(info.raft_port);
     LogInfo ( "Switching to " + addr );
-    client_ = RaftClient ( grpc::CreateChannel( addr, grpc::InsecureChannelCredentials() ) );
+    client_ = RaftClient ( grpc::CreateChannel( addr, grpc::InsecureChannelCredentials() ), group_ );
 }
 
 void Admin::SwitchClient ( std::string addr )
 {
     LogInfo ( "Switching to " + addr );
-    client_ = RaftClient ( grpc::CreateChannel( addr, grpc::InsecureChannelCredentials() ) );
+    client_ = RaftClient ( grpc::CreateChannel( addr, grpc::InsecureChannelCredentials() ), group_ );
 }
 
 bool Admin::AddServer( int id, std::string ip, int db_port, int raft_port, std::string name ) 
 {
     // make sure the new server is already present
     client_ = RaftClient (
-        grpc::CreateChannel( ip + ":" + std::to_string(raft_port), grpc::InsecureChannelCredentials() ));
+        grpc::CreateChannel( ip + ":" + std::to_string(raft_port), grpc::InsecureChannelCredentials() ), group_ );
     if ( client_.Ping(1) < 0 )
     {
         LogError( "Failed to connect to new server. Aborting." );
@@ -103,7 +107,8 @@ bool Admin::AddServer( int id, std::string ip, int db_port, int raft_port, std::
                 LogWarn( "Server already exists in the cluster. Success." );
                 return true;
             }
-            case raft::ErrorCode::SERVER_NOT_FOUND: {
+            case raft::ErrorCode::SERVER_NOT_FOUND:
+            case raft::ErrorCode::TRANSFER_FAILED: {
                 __builtin_unreachable();
             }
             case raft::ErrorCode::OTHER: {
@@ -165,7 +170,8 @@ bool Admin::RemoveServer( int id )
                 LogWarn( "Server not found in the cluster. Aborting." );
                 return false;
             }
-            case raft::ErrorCode::SERVER_EXISTS: {
+            case raft::ErrorCode::SERVER_EXISTS:
+            case raft::ErrorCode::TRANSFER_FAILED: {
               __builtin_unreachable();
             }
             case raft::ErrorCode::OTHER: {
@@ -179,6 +185,66 @@ bool Admin::RemoveServer( int id )
     return false;
 }
 
+bool Admin::TransferLeadership( int id )
+{
+    raft::TransferLeadershipParams param = {
+        .serverId = id
+    };
+
+    auto iters = MAX_TRIES;
+    int server_id = 0;
+    SwitchClient( server_id );
+
+    while ( iters-- ) {
+        auto ret = client_.TransferLeadership( param );
+
+        if ( !ret.has_value() ) {
+            LogError( "Failed to connect to server. It may be dead. Retrying with others." );
+            server_id++;
+            if ( server_id >= (int)servers_.size() ) {
+                LogError( "All servers are dead. Aborting." );
+                return false;
+            }
+            SwitchClient( server_id );
+            continue;
+        }
+
+        switch ( ret.value().errorCode ) {
+            case raft::ErrorCode::OK: {
+                LogInfo( "Successfully handed leadership to " + std::to_string(id) );
+                return true;
+            }
+            case raft::ErrorCode::NOT_LEADER: {
+                LogWarn( "This server is not the leader. ");
+                SwitchClient( ret.value().leaderAddr );
+                break;
+            }
+            case raft::ErrorCode::SERVER_NOT_FOUND: {
+                LogWarn( "Server not found in the cluster. Aborting." );
+                return false;
+            }
+            case raft::ErrorCode::TRANSFER_FAILED: {
+                LogWarn( "Server did not take over in time. Retrying." );
+                break;
+            }
+            case raft::ErrorCode::PREV_NOT_COMMITTED_TIMEOUT:
+            case raft::ErrorCode::CUR_NOT_COMMITTED_TIMEOUT:
+            case raft::ErrorCode::SERVER_EXISTS: {
+                __builtin_unreachable();
+            }
+            case raft::ErrorCode::OTHER: {
+                LogWarn( "Unknown error. Retrying." );
+                break;
+            }
+        }
+
+        std::this_thread::sleep_for( std::chrono::milliseconds(500) );
+    }
+
+    LogWarn( "Failed to hand over leadership after " + std::to_string(MAX_TRIES) + " tries." );
+    return false;
+}
+
 bool Admin::WriteConfig( std::string filename, std::map<int32_t, ServerInfo> servers )
 {
     // file is a csv, with header 
@@ -208,10 +274,10 @@ int main(int argc, char **argv)
 
     program.add_argument("--op")
         .required()
-        .help("Operation to perform. Either add or rm.");
+        .help("Operation to perform. Either add, rm or transfer (leadership).");
     
     program.add_argument("--id")
-        .help("The node ID to add or to remove.")
+        .help("The node ID to add, to remove or to hand leadership to.")
         .default_value("-1");
 
     program.add_argument("--ip")
@@ -230,6 +296,10 @@ int main(int argc, char **argv)
         .help("Name of the node. Only needed when addedNode is true.")
         .default_value("");
 
+    program.add_argument("--shards")
+        .help("number of shards the replicas run with, the change is made in every shard's group")
+        .default_value("1");
+
 
     try {
         program.parse_args( argc, argv );
@@ -241,8 +311,8 @@ int main(int argc, char **argv)
     }
 
     std::string op = program.get<std::string>("--op");
-    if ( op != "add" && op != "rm" ) {
-        std::cerr << "Invalid operation. Must be either add or rm." << std::endl;
+    if ( op != "add" && op != "rm" && op != "transfer" ) {
+        std::cerr << "Invalid operation. Must be either add, rm or transfer." << std::endl;
         std::exit(1);
     }
 
@@ -252,13 +322,25 @@ int main(int argc, char **argv)
     auto raft_port = std::stoi(program.get<std::string>("--raft_port"));
     auto db_port = std::stoi(program.get<std::string>("--db_port"));
     auto name = program.get<std::string>("--name");
+    auto shards = std::stoi(program.get<std::string>("--shards"));
 
     auto servers = ParseConfig(configPath);
 
+    // groups are changed one after the other, stopping at the first failure
+    auto forAllGroups = [&]( auto&& change ) {
+        for ( int32_t group = 0; group < shards; ++group ) {
+            auto admin = Admin( servers, group );
+            if ( ! change( admin ) ) {
+                LogError( "Change failed in Group=" + std::to_string( group ) );
+                return false;
+            }
+        }
+        return true;
+    };
     auto admin = Admin( servers );
 
     if ( op == "add" ) {
-        auto ret = admin.AddServer( id, ip, db_port, raft_port, name );
+        auto ret = forAllGroups( [&]( Admin& a ) { return a.AddServer( id, ip, db_port, raft_port, name ); } );
         if ( ret )
         {
             ServerInfo info = {
@@ -272,12 +354,14 @@ int main(int argc, char **argv)
             admin.WriteConfig( configPath, servers );
         }
     } else if ( op == "rm" ) {
-        auto ret = admin.RemoveServer( id );
+        auto ret = forAllGroups( [&]( Admin& a ) { return a.RemoveServer( id ); } );
         if ( ret )
         {
             servers.erase( id );
             admin.WriteConfig( configPath, servers );
         }
+    } else if ( op == "transfer" ) {
+        forAllGroups( [&]( Admin& a ) { return a.TransferLeadership( id ); } );
     }
     
     return 0;
@@ -0,0 +1,506 @@
+// ohmybench: load generator for an OhMyDB cluster.
+//
+// Every client thread drives its own AsyncReplicatedDB and keeps up to
+// --outstanding requests in flight. In closed loop a thread sends the next
+// request as soon as one finishes. In open loop requests are due at a fixed
+// rate, and latency counts from when a request was due, so a backed up
+// cluster shows up as latency instead of as a lower send rate.
+//
+// After --warmup_s the latencies go into one histogram per interval, which
+// is printed and written to --csv (see scripts/vis.py --bench).
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <argparse/argparse.hpp>
+
+#include "OhMyConfig.H"
+#include "DatabaseUtils.H"
+#include "WowLogger.H"
+#include "WowMetrics.H"
+#include "AsyncReplicatedDB.H"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+// Picks the keys for requests out of [0, numKeys). Shared by the client
+// threads, each bringing its own rng.
+class KeyChooser
+{
+public:
+    virtual ~KeyChooser() {}
+    virtual int32_t next(std::mt19937_64& rng) const = 0;
+
+protected:
+    static double unit(std::mt19937_64& rng) {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    }
+};
+
+class UniformKeys : public KeyChooser
+{
+public:
+    explicit UniformKeys(int32_t numKeys) : numKeys_(numKeys) {}
+    int32_t next(std::mt19937_64& rng) const override {
+        return std::uniform_int_distribution<int32_t>(0, numKeys_ - 1)(rng);
+    }
+
+private:
+    int32_t numKeys_;
+};
+
+// Zipfian over ranks as in Gray et al, "Quickly Generating Billion-Record
+// Synthetic Databases". Ranks are hashed to keys, so the popular keys are
+// spread over the key range instead of all being at the start of it.
+class ZipfianKeys : public KeyChooser
+{
+public:
+    ZipfianKeys(int32_t numKeys, double theta);
+    int32_t next(std::mt19937_64& rng) const override;
+
+private:
+    int32_t numKeys_;
+    double theta_;
+    double zetaN_;
+    double alpha_;
+    double eta_;
+};
+
+inline ZipfianKeys::ZipfianKeys(int32_t numKeys, double theta)
+    : numKeys_(numKeys), theta_(theta)
+{
+    zetaN_ = 0;
+    for ( int32_t i = 1; i <= numKeys; ++i ) {
+        zetaN_ += 1.0 / std::pow(i, theta);
+    }
+    double zeta2 = 1.0 + 1.0 / std::pow(2, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / numKeys, 1.0 - theta)) / (1.0 - zeta2 / zetaN_);
+}
+
+inline int32_t ZipfianKeys::next(std::mt19937_64& rng) const
+{
+    double u = unit(rng);
+    double uz = u * zetaN_;
+    uint64_t rank;
+    if ( uz < 1.0 ) {
+        rank = 0;
+    } else if ( uz < 1.0 + std::pow(0.5, theta_) ) {
+        rank = 1;
+    } else {
+        rank = static_cast<uint64_t>(numKeys_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    }
+    // FNV-1a over the rank
+    uint64_t hash = 14695981039346656037ull;
+    for ( int i = 0; i < 8; ++i ) {
+        hash = (hash ^ ((rank >> (i * 8)) & 0xff)) * 1099511628211ull;
+    }
+    return static_cast<int32_t>(hash % numKeys_);
+}
+
+// hotOps of the requests go to the first hotKeys of the key range
+class HotspotKeys : public KeyChooser
+{
+public:
+    HotspotKeys(int32_t numKeys, double hotKeys, double hotOps)
+        : numKeys_(numKeys), hotOps_(hotOps),
+          numHot_(std::clamp(static_cast<int32_t>(numKeys * hotKeys), 1, numKeys)) {}
+
+    int32_t next(std::mt19937_64& rng) const override {
+        if ( numHot_ == numKeys_ || unit(rng) < hotOps_ ) {
+            return std::uniform_int_distribution<int32_t>(0, numHot_ - 1)(rng);
+        }
+        return std::uniform_int_distribution<int32_t>(numHot_, numKeys_ - 1)(rng);
+    }
+
+private:
+    int32_t numKeys_;
+    double hotOps_;
+    int32_t numHot_;
+};
+
+struct BenchOptions {
+    int32_t threads = 1;
+    int32_t outstanding = 16;
+    double rate = 0; // requests per second over all threads, 0 for closed loop
+    int32_t numKeys = 100000;
+    double readRatio = 0.5;
+    int32_t batch = 1; // pairs per write, more than one goes as a BatchPut
+    std::chrono::milliseconds warmup { 5000 };
+    std::chrono::milliseconds duration { 30000 };
+    std::chrono::milliseconds interval { 1000 };
+    ohmydb::ReadOptions readOpts;
+    ohmydb::AsyncOptions asyncOpts;
+};
+
+// Latencies of what finished after the warmup, by interval. The histograms
+// of an interval are read and reset half an interval after it ends, and
+// only taken again Slots intervals later.
+class Recorder
+{
+public:
+    Recorder(bench_clock_t::time_point measureStart, std::chrono::milliseconds interval)
+        : measureStart_(measureStart), interval_(interval) {}
+
+    void record(bool isRead, bool ok, bench_clock_t::time_point due, bench_clock_t::time_point done);
+
+    struct Interval {
+        WowMetrics::Histogram reads;
+        WowMetrics::Histogram writes;
+        std::atomic<int64_t> readMisses { 0 };
+        std::atomic<int64_t> writeErrors { 0 };
+    };
+
+    static constexpr int32_t Slots = 4;
+    Interval& slot(int64_t index) { return slots_[index % Slots]; }
+
+    // everything after the warmup
+    Interval total;
+
+private:
+    bench_clock_t::time_point measureStart_;
+    std::chrono::milliseconds interval_;
+    Interval slots_[Slots];
+};
+
+inline void Recorder::record(bool isRead, bool ok, bench_clock_t::time_point due,
+                             bench_clock_t::time_point done)
+{
+    if ( done < measureStart_ ) {
+        return;
+    }
+    auto latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(done - due).count();
+    auto index = (done - measureStart_) / interval_;
+    for ( auto interval : { &slot(index), &total } ) {
+        if ( isRead ) {
+            interval->reads.record(latencyUs);
+            if ( ! ok ) {
+                interval->readMisses++;
+            }
+        } else {
+            interval->writes.record(latencyUs);
+            if ( ! ok ) {
+                interval->writeErrors++;
+            }
+        }
+    }
+}
+
+// One client thread, with requests in flight tracked under mut_ since they
+// complete on the AsyncReplicatedDB thread
+class Worker
+{
+public:
+    Worker(std::map<int32_t, ServerInfo> servers, const BenchOptions& opts, const KeyChooser& keys,
+           Recorder& recorder, uint64_t seed)
+        : opts_(opts), keys_(keys), recorder_(recorder), rng_(seed),
+          db_(std::move(servers), opts.asyncOpts) {}
+
+    void run(bench_clock_t::time_point start, bench_clock_t::time_point stop);
+
+private:
+    void issue(bench_clock_t::time_point due);
+    void done(bool isRead, bool ok, bench_clock_t::time_point due);
+
+    const BenchOptions& opts_;
+    const KeyChooser& keys_;
+    Recorder& recorder_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> unit_ { 0.0, 1.0 };
+    ohmydb::AsyncReplicatedDB db_;
+
+    std::mutex mut_;
+    std::condition_variable cv_;
+    int32_t inFlight_ = 0;
+};
+
+inline void Worker::run(bench_clock_t::time_point start, bench_clock_t::time_point stop)
+{
+    // open loop spaces this thread's requests evenly
+    bench_clock_t::duration period {};
+    if ( opts_.rate > 0 ) {
+        period = std::chrono::duration_cast<bench_clock_t::duration>(
+            std::chrono::duration<double>(opts_.threads / opts_.rate));
+    }
+    auto due = start;
+    while ( true ) {
+        if ( opts_.rate > 0 ) {
+            std::this_thread::sleep_until(due);
+        } else {
+            due = bench_clock_t::now();
+        }
+        if ( due >= stop ) {
+            break;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mut_);
+            cv_.wait(lock, [this]{ return inFlight_ < opts_.outstanding; });
+            inFlight_++;
+        }
+        issue(due);
+        due += period;
+    }
+    std::unique_lock<std::mutex> lock(mut_);
+    cv_.wait(lock, [this]{ return inFlight_ == 0; });
+}
+
+inline void Worker::issue(bench_clock_t::time_point due)
+{
+    if ( unit_(rng_) < opts_.readRatio ) {
+        db_.get(keys_.next(rng_), [this, due]( std::optional<int32_t> val ) {
+            done(true, val.has_value(), due);
+        }, opts_.readOpts);
+        return;
+    }
+    auto cb = [this, due]( bool ok ) { done(false, ok, due); };
+    if ( opts_.batch <= 1 ) {
+        db_.put({ keys_.next(rng_), static_cast<int32_t>(rng_()) }, cb);
+        return;
+    }
+    std::vector<std::pair<int32_t, int32_t>> kvps;
+    kvps.reserve(opts_.batch);
+    for ( int32_t i = 0; i < opts_.batch; ++i ) {
+        kvps.emplace_back(keys_.next(rng_), static_cast<int32_t>(rng_()));
+    }
+    db_.batchPut(std::move(kvps), cb);
+}
+
+inline void Worker::done(bool isRead, bool ok, bench_clock_t::time_point due)
+{
+    recorder_.record(isRead, ok, due, bench_clock_t::now());
+    std::lock_guard<std::mutex> lock(mut_);
+    inFlight_--;
+    cv_.notify_all();
+}
+
+// Writes every key once, so that reads find something
+void preload(std::map<int32_t, ServerInfo> servers, int32_t numKeys)
+{
+    constexpr int32_t PreloadBatch = 512;
+    ohmydb::AsyncReplicatedDB db(std::move(servers));
+    std::vector<std::future<bool>> puts;
+    for ( int32_t start = 0; start < numKeys; start += PreloadBatch ) {
+        std::vector<std::pair<int32_t, int32_t>> kvps;
+        for ( int32_t key = start; key < std::min(numKeys, start + PreloadBatch); ++key ) {
+            kvps.emplace_back(key, key);
+        }
+        auto pr = std::make_shared<std::promise<bool>>();
+        puts.push_back(pr->get_future());
+        db.batchPut(std::move(kvps), [pr]( bool ok ) { pr->set_value(ok); });
+    }
+    size_t failed = 0;
+    for ( auto& ft : puts ) {
+        failed += ! ft.get();
+    }
+    std::cout << "Preloaded " << numKeys << " keys, " << failed << " batches failed\n";
+}
+
+void printHeader(std::ostream& out)
+{
+    out << "time_s,ops,ops_per_s,"
+        << "read_ops,read_p50_us,read_p99_us,read_p999_us,read_misses,"
+        << "write_ops,write_p50_us,write_p99_us,write_p999_us,write_errors\n";
+}
+
+void printRow(std::ostream& out, double timeS, double seconds, const Recorder::Interval& interval)
+{
+    auto reads = interval.reads.stats();
+    auto writes = interval.writes.stats();
+    auto ops = reads.count + writes.count;
+    out << timeS << "," << ops << "," << ops / seconds << ","
+        << reads.count << "," << reads.p50 << "," << reads.p99 << "," << reads.p999 << ","
+        << interval.readMisses << ","
+        << writes.count << "," << writes.p50 << "," << writes.p99 << "," << writes.p999 << ","
+        << interval.writeErrors << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("ohmybench");
+    program.add_argument("--config")
+        .required()
+        .help("Config file.");
+
+    program.add_argument("--threads")
+        .default_value("1")
+        .help("Client threads, each with its own connections.");
+
+    program.add_argument("--outstanding")
+        .default_value("16")
+        .help("Requests each thread keeps in flight at most.");
+
+    program.add_argument("--rate")
+        .default_value("0")
+        .help("Open loop: requests per second over all threads. 0 runs closed loop.");
+
+    program.add_argument("--numkeys")
+        .default_value("100000")
+        .help("Keys are picked out of [0, numkeys).");
+
+    program.add_argument("--dist")
+        .default_value("uniform")
+        .help("Key distribution: uniform, zipfian or hotspot.");
+
+    program.add_argument("--zipf_theta")
+        .default_value("0.99")
+        .help("Skew of the zipfian distribution, in (0, 1).");
+
+    program.add_argument("--hot_keys")
+        .default_value("0.01")
+        .help("Hotspot: fraction of the keys that are hot.");
+
+    program.add_argument("--hot_ops")
+        .default_value("0.9")
+        .help("Hotspot: fraction of the requests that go to hot keys.");
+
+    program.add_argument("--read_ratio")
+        .default_value("0.5")
+        .help("Fraction of the requests that are gets, the rest are puts.");
+
+    program.add_argument("--batch")
+        .default_value("1")
+        .help("Pairs per write. Values are fixed size, so this is how a write gets bigger.");
+
+    program.add_argument("--max_staleness_ms")
+        .default_value("-1")
+        .help("Let any replica serve reads, at most this stale (0 for no bound, -1 for leader reads).");
+
+    program.add_argument("--batch_window_us")
+        .default_value("0")
+        .help("Client side grouping of puts into BatchPuts, 0 disables.");
+
+    program.add_argument("--warmup_s")
+        .default_value("5")
+        .help("Seconds of load before anything is measured.");
+
+    program.add_argument("--duration_s")
+        .default_value("30")
+        .help("Seconds measured after the warmup.");
+
+    program.add_argument("--interval_ms")
+        .default_value("1000")
+        .help("Length of each reported interval.");
+
+    program.add_argument("--csv")
+        .default_value("bench.csv")
+        .help("Per interval results go here.");
+
+    program.add_argument("--preload")
+        .default_value( false )
+        .implicit_value( true )
+        .help("Write every key once before starting.");
+
+    program.add_argument("--seed")
+        .default_value("1")
+        .help("Seed for keys, values and the read/write mix.");
+
+    try {
+        program.parse_args( argc, argv );
+    }
+    catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    BenchOptions opts;
+    opts.threads = std::max(1, std::stoi(program.get<std::string>("--threads")));
+    opts.outstanding = std::max(1, std::stoi(program.get<std::string>("--outstanding")));
+    opts.rate = std::stod(program.get<std::string>("--rate"));
+    opts.numKeys = std::max(1, std::stoi(program.get<std::string>("--numkeys")));
+    opts.readRatio = std::stod(program.get<std::string>("--read_ratio"));
+    opts.batch = std::max(1, std::stoi(program.get<std::string>("--batch")));
+    opts.warmup = std::chrono::seconds(std::stoi(program.get<std::string>("--warmup_s")));
+    opts.duration = std::chrono::seconds(std::stoi(program.get<std::string>("--duration_s")));
+    opts.interval = std::chrono::milliseconds(std::max(1, std::stoi(program.get<std::string>("--interval_ms"))));
+    auto maxStalenessMs = std::stoi(program.get<std::string>("--max_staleness_ms"));
+    if ( maxStalenessMs >= 0 ) {
+        opts.readOpts.allowStale = true;
+        opts.readOpts.maxStalenessMs = maxStalenessMs;
+    }
+    opts.asyncOpts.maxInFlight = opts.outstanding;
+    opts.asyncOpts.batchWindowUs = std::stoi(program.get<std::string>("--batch_window_us"));
+    auto seed = std::stoull(program.get<std::string>("--seed"));
+
+    std::unique_ptr<KeyChooser> keys;
+    auto dist = program.get<std::string>("--dist");
+    if ( dist == "uniform" ) {
+        keys = std::make_unique<UniformKeys>(opts.numKeys);
+    } else if ( dist == "zipfian" ) {
+        keys = std::make_unique<ZipfianKeys>(opts.numKeys, std::stod(program.get<std::string>("--zipf_theta")));
+    } else if ( dist == "hotspot" ) {
+        keys = std::make_unique<HotspotKeys>(opts.numKeys, std::stod(program.get<std::string>("--hot_keys")),
+                                             std::stod(program.get<std::string>("--hot_ops")));
+    } else {
+        std::cerr << "Unknown key distribution: " << dist << std::endl;
+        std::exit(1);
+    }
+
+    std::ofstream csv(program.get<std::string>("--csv"));
+    if ( ! csv ) {
+        std::cerr << "Can't write " << program.get<std::string>("--csv") << std::endl;
+        std::exit(1);
+    }
+
+    auto servers = ParseConfig(program.get<std::string>("--config"));
+    if ( program["--preload"] == true ) {
+        preload(servers, opts.numKeys);
+    }
+
+    auto start = bench_clock_t::now();
+    auto measureStart = start + opts.warmup;
+    auto stop = measureStart + opts.duration;
+    Recorder recorder(measureStart, opts.interval);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for ( int32_t i = 0; i < opts.threads; ++i ) {
+        workers.push_back(std::make_unique<Worker>(servers, opts, *keys, recorder, seed + i));
+    }
+    std::vector<std::thread> threads;
+    for ( auto& worker : workers ) {
+        threads.emplace_back([&worker, start, stop]{ worker->run(start, stop); });
+    }
+
+    printHeader(std::cout);
+    printHeader(csv);
+    auto seconds = std::chrono::duration<double>(opts.interval).count();
+    int64_t numIntervals = opts.duration / opts.interval;
+    for ( int64_t i = 0; i < numIntervals; ++i ) {
+        // late completions of interval i still land in its slot
+        std::this_thread::sleep_until(measureStart + (i + 1) * opts.interval + opts.interval / 2);
+        auto& interval = recorder.slot(i);
+        printRow(std::cout, (i + 1) * seconds, seconds, interval);
+        printRow(csv, (i + 1) * seconds, seconds, interval);
+        csv.flush();
+        interval.reads.reset();
+        interval.writes.reset();
+        interval.readMisses = 0;
+        interval.writeErrors = 0;
+    }
+
+    for ( auto& t : threads ) {
+        t.join();
+    }
+
+    auto total = std::chrono::duration<double>(opts.duration).count();
+    auto reads = recorder.total.reads.stats();
+    auto writes = recorder.total.writes.stats();
+    std::cout << "========================\n";
+    std::cout << "Benchmark Results:\n";
+    std::cout << "Mode: " << ( opts.rate > 0 ? "open loop at " + std::to_string(opts.rate) + " ops/s" : "closed loop" )
+              << ", " << opts.threads << " threads x " << opts.outstanding << " outstanding\n";
+    std::cout << "Throughput: " << (reads.count + writes.count) / total << " ops/s\n";
+    std::cout << "Reads (us): " << reads.str() << " misses=" << recorder.total.readMisses << "\n";
+    std::cout << "Writes (us): " << writes.str() << " errors=" << recorder.total.writeErrors << "\n";
+    return 0;
+}
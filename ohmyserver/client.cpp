@@ -6,12 +6,15 @@
 #include <memory>
 #include <argparse/argparse.hpp>
 #include <chrono>
+#include <future>
+#include <vector>
 
 #include "OhMyConfig.H"
 #include "DatabaseClient.H"
 #include "DatabaseUtils.H"
 #include "WowLogger.H"
 #include "ReplicatedDB.H"
+#include "AsyncReplicatedDB.H"
 #include <random>
 
 void writeTest(ohmydb::ReplicatedDB &repDB, size_t numPairs, size_t iter)
@@ -37,12 +40,13 @@ void writeTest(ohmydb::ReplicatedDB &repDB, size_t numPairs, size_t iter)
 
 }
 
-void readTest(ohmydb::ReplicatedDB &repDB, size_t numPairs, size_t iter)
+void readTest(ohmydb::ReplicatedDB &repDB, size_t numPairs, size_t iter,
+              ohmydb::ReadOptions opts)
 {
     auto start = std::chrono::high_resolution_clock::now();
     for(size_t i = 0; i < iter; i++)
     {
-        repDB.get(rand()%numPairs);
+        repDB.get(rand()%numPairs, opts);
     }
     auto end = std::chrono::high_resolution_clock::now();
 
@@ -91,6 +95,84 @@ void readWriteTest(ohmydb::ReplicatedDB &repDB, size_t numPairs, size_t iter)
 
 }
 
+void scanTest(ohmydb::ReplicatedDB &repDB, size_t numPairs, ohmydb::ReadOptions opts)
+{
+    // one pass over the whole key range, checking that keys come in order
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t count = 0;
+    bool ordered = true;
+    int lastKey = -1;
+    bool ok = repDB.scan( 0, static_cast<int32_t>(numPairs), 0,
+                          [&]( const std::vector<std::pair<int, int>>& chunk ) {
+        for ( auto& [key, val] : chunk ) {
+            ordered = ordered && key > lastKey;
+            lastKey = key;
+        }
+        count += chunk.size();
+    }, opts );
+    auto end = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    std::cout << "========================\n";
+    std::cout << "Scan Test Results:\n";
+    std::cout << "Status: " << ( ok ? "OK" : "FAILED" ) << ( ordered ? "" : ", out of order" ) << "\n";
+    std::cout << "Pairs: " << count << "\n";
+    std::cout << "Elapsed Time: " << duration / 1000.0 << " s\n";
+}
+
+void asyncWriteReadTest(ohmydb::AsyncReplicatedDB &asyncDB, size_t numPairs, size_t iter)
+{
+    // the client keeps up to maxInFlight of these going at once
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::future<bool>> puts;
+    puts.reserve(iter);
+    for(size_t i = 0; i < iter; i++)
+    {
+        puts.push_back( asyncDB.put( std::make_pair( rand()%numPairs, rand()) ) );
+    }
+    asyncDB.flush();
+    size_t failed = 0;
+    for(auto &ft : puts)
+    {
+        failed += ft.get() ? 0 : 1;
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::future<std::optional<int32_t>>> gets;
+    gets.reserve(iter);
+    for(size_t i = 0; i < iter; i++)
+    {
+        gets.push_back( asyncDB.get( rand()%numPairs ) );
+    }
+    for(auto &ft : gets)
+    {
+        ft.get();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    auto writeMs = std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count();
+    auto readMs = std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count();
+
+    std::cout << "========================\n";
+    std::cout << "Async Test Results:\n";
+    std::cout << "Operations: " << iter << " writes, " << iter << " reads\n";
+    std::cout << "Failed Writes: " << failed << "\n";
+    std::cout << "Write Time: " << writeMs / 1000.0 << " s\n";
+    std::cout << "Read Time: " << readMs / 1000.0 << " s\n";
+}
+
+void printStats(std::map<int32_t, ServerInfo> servers, const std::string& prefix)
+{
+    for ( auto& [id, info] : servers ) {
+        auto serverAddr = std::string(info.ip) + ":" + std::to_string(info.db_port);
+        OhMyDBClient client(grpc::CreateChannel(serverAddr, grpc::InsecureChannelCredentials()));
+        auto stats = client.GetStats(prefix);
+        std::cout << "Replica " << id << " (" << serverAddr << ")\n";
+        std::cout << stats.value_or("unreachable\n") << "\n";
+    }
+}
+
 int main(int argc, char **argv)
 {
     argparse::ArgumentParser program("client");
@@ -106,6 +188,32 @@ int main(int argc, char **argv)
         .default_value("10")
         .help("Number of possible keys for testing.");
 
+    program.add_argument("--max_staleness_ms")
+        .default_value("-1")
+        .help("Let any replica serve the read test, at most this stale (0 for no bound, -1 for leader reads).");
+
+    program.add_argument("--async")
+        .default_value( false )
+        .implicit_value( true )
+        .help("Pipeline the requests through the async client instead.");
+
+    program.add_argument("--max_inflight")
+        .default_value("4096")
+        .help("Most requests the async client keeps outstanding.");
+
+    program.add_argument("--batch_window_us")
+        .default_value("0")
+        .help("Async client groups puts issued within this window into one BatchPut, 0 disables.");
+
+    program.add_argument("--stats")
+        .default_value( false )
+        .implicit_value( true )
+        .help("Print the metrics of every replica instead of running the tests.");
+
+    program.add_argument("--stats_prefix")
+        .default_value("")
+        .help("With --stats, only metrics whose name starts with this.");
+
     //program.add_argument("--id")
     //    .default_value("0")
     //    .help("Initial node to contact.");
@@ -125,13 +233,35 @@ int main(int argc, char **argv)
     auto configPath = program.get<std::string>("--config");
     auto iter = std::stoi(program.get<std::string>("--iter"));
     auto numPairs = std::stoi(program.get<std::string>("--numkeys"));
+    auto maxStalenessMs = std::stoi(program.get<std::string>("--max_staleness_ms"));
+
+    ohmydb::ReadOptions readOpts;
+    if ( maxStalenessMs >= 0 ) {
+        readOpts.allowStale = true;
+        readOpts.maxStalenessMs = maxStalenessMs;
+    }
 
     auto servers = ParseConfig(configPath);
 
+    if ( program["--stats"] == true ) {
+        printStats(servers, program.get<std::string>("--stats_prefix"));
+        return 0;
+    }
+
+    if ( program["--async"] == true ) {
+        ohmydb::AsyncOptions asyncOpts;
+        asyncOpts.maxInFlight = std::stoi(program.get<std::string>("--max_inflight"));
+        asyncOpts.batchWindowUs = std::stoi(program.get<std::string>("--batch_window_us"));
+        ohmydb::AsyncReplicatedDB asyncDB(servers, asyncOpts);
+        asyncWriteReadTest(asyncDB, numPairs, 1lu<<iter);
+        return 0;
+    }
+
     auto repDB = ohmydb::ReplicatedDB(servers);
     writeTest(repDB, numPairs, 1lu<<iter);
-    readTest(repDB, numPairs, 1lu<<iter);
+    readTest(repDB, numPairs, 1lu<<iter, readOpts);
     readWriteTest(repDB, numPairs, 1lu<<iter);
+    scanTest(repDB, numPairs, readOpts);
 
     // for test only
     //auto printOpt = []( auto&& tag, auto&& opt ) {
@@ -0,0 +1,146 @@
+// Checks that OrderedCodec keeps the integer order under leveldb's bytewise
+// order, and that a db holding the decimal pairs we used to write is
+// converted on open, while one with a format marker we don't know, or one
+// that can't be opened at all, fails to initialize.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <memory>
+#include <utility>
+#include <unistd.h>
+
+#include <leveldb/db.h>
+
+#include "LevelDBProxy.H"
+
+using namespace raft;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if ( ! ( cond ) ) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << " CHECK failed: " #cond << std::endl; \
+      ++failures; \
+    } \
+  } while ( 0 )
+
+// vals must be in increasing order
+template <class IntT>
+static void checkOrder( const std::vector<IntT>& vals )
+{
+  using Codec = OrderedCodec<IntT>;
+  for ( size_t i = 0; i < vals.size(); ++i ) {
+    auto buf = Codec::encode( vals[i] );
+    auto back = Codec::decode( Codec::slice( buf ) );
+    CHECK( back.has_value() && back.value() == vals[i] );
+    if ( i > 0 ) {
+      auto prev = Codec::encode( vals[i - 1] );
+      CHECK( Codec::slice( prev ).compare( Codec::slice( buf ) ) < 0 );
+    }
+  }
+}
+
+static void testOrderedCodec()
+{
+  checkOrder<int>( { INT_MIN, INT_MIN + 1, -65536, -256, -255, -1, 0, 1, 255, 256, 65536, INT_MAX - 1, INT_MAX } );
+  checkOrder<int64_t>( { INT64_MIN, -( int64_t(1) << 32 ), -1, 0, 1, int64_t(1) << 32, INT64_MAX } );
+  checkOrder<uint32_t>( { 0, 1, 255, 256, 1u << 31, UINT32_MAX } );
+  checkOrder<int8_t>( { -128, -1, 0, 1, 127 } );
+
+  // anything but the exact width is turned away
+  std::string shortBuf( sizeof(int) - 1, '\0' );
+  std::string longBuf( sizeof(int) + 1, '\0' );
+  CHECK( ! OrderedCodec<int>::decode( leveldb::Slice( shortBuf ) ).has_value() );
+  CHECK( ! OrderedCodec<int>::decode( leveldb::Slice( longBuf ) ).has_value() );
+  CHECK( ! OrderedCodec<int>::decode( leveldb::Slice( DB_FORMAT_KEY ) ).has_value() );
+}
+
+static bool writeRaw( const std::string& path, const std::vector<std::pair<std::string, std::string>>& pairs )
+{
+  leveldb::Options options;
+  options.create_if_missing = true;
+  leveldb::DB* db = nullptr;
+  if ( ! leveldb::DB::Open( options, path, &db ).ok() ) {
+    return false;
+  }
+  std::unique_ptr<leveldb::DB> owner( db );
+  for ( auto& [key, val] : pairs ) {
+    if ( ! db->Put( leveldb::WriteOptions(), key, val ).ok() ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void testMigration( const std::string& dir )
+{
+  auto path = dir + "/decimal";
+  CHECK( writeRaw( path, {
+    { "10", "100" }, { "-5", "-50" }, { "2", "20" }, { "-300", "7" },
+    { "banana", "1" }, { "3", "x" }
+  } ) );
+
+  auto& db = LevelDB<int, int>::Instance( 0 );
+  CHECK( db.initialize( path ) );
+  CHECK( db.get( 10 ) == 100 );
+  CHECK( db.get( -5 ) == -50 );
+  CHECK( db.get( 2 ) == 20 );
+  CHECK( db.get( -300 ) == 7 );
+  // the unreadable pairs are dropped
+  CHECK( ! db.get( 3 ).has_value() );
+
+  // the converted keys come back in integer order, not string order
+  std::vector<std::pair<int, int>> seen;
+  auto cursor = db.scan( INT_MIN, {} );
+  std::pair<int, int> kv;
+  while ( cursor->next( kv ) ) {
+    seen.push_back( kv );
+  }
+  std::vector<std::pair<int, int>> expected { { -300, 7 }, { -5, -50 }, { 2, 20 }, { 10, 100 } };
+  CHECK( seen == expected );
+
+  // writes after the conversion land next to the converted pairs
+  CHECK( db.put( { 5, 55 } ) );
+  CHECK( db.get( 5 ) == 55 );
+}
+
+static void testUnknownFormat( const std::string& dir )
+{
+  auto path = dir + "/future";
+  CHECK( writeRaw( path, { { "1", "1" }, { DB_FORMAT_KEY, std::string( 1, DB_FORMAT_VERSION + 1 ) } } ) );
+  auto& db = LevelDB<int, int>::Instance( 1 );
+  CHECK( ! db.initialize( path ) );
+}
+
+static void testOpenFailure( const std::string& dir )
+{
+  // leveldb creates the db directory but not its parents
+  auto& db = LevelDB<int, int>::Instance( 2 );
+  CHECK( ! db.initialize( dir + "/missing/db" ) );
+}
+
+int main()
+{
+  testOrderedCodec();
+
+  char dir[] = "/tmp/db_test.XXXXXX";
+  if ( mkdtemp( dir ) == nullptr ) {
+    CHECK( ! "mkdtemp failed" );
+  } else {
+    testMigration( dir );
+    testUnknownFormat( dir );
+    testOpenFailure( dir );
+    std::system( ( "rm -rf " + std::string( dir ) ).c_str() );
+  }
+
+  if ( failures > 0 ) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "db_test passed" << std::endl;
+  return 0;
+}
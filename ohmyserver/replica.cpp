@@ -86,6 +86,101 @@ int main(int argc, char **argv)
       .help("DB port of the node. Only needed when addedNode is true.")
       .default_value("-1");
     
+  program.add_argument("--shards")
+      .help("raft groups the keys are hashed over, each with its own leader and log. Use the same on all replicas")
+      .default_value("1");
+
+  program.add_argument("--heartbeat_ms")
+      .help("leader heartbeat period when there are no new ops")
+      .default_value( std::to_string( raft::RAFT_LEADER_PERIOD_MS ) );
+
+  program.add_argument("--election_timeout_min_ms")
+      .help("followers call an election after a random timeout between min and max without word from the leader, use the same on all replicas")
+      .default_value( std::to_string( raft::RAFT_ELECTION_TIMEOUT_MIN_MS ) );
+
+  program.add_argument("--election_timeout_max_ms")
+      .help("see election_timeout_min_ms")
+      .default_value( std::to_string( raft::RAFT_ELECTION_TIMEOUT_MAX_MS ) );
+
+  program.add_argument("--no_prevote")
+      .help("call elections without first checking that they can be won")
+      .default_value( false )
+      .implicit_value( true );
+
+  program.add_argument("--no_check_quorum")
+      .help("keep leading without hearing from a majority")
+      .default_value( false )
+      .implicit_value( true );
+
+  program.add_argument("--commit_window_us")
+      .help("how long the leader waits to group ops into one append, 0 disables")
+      .default_value("0");
+
+  program.add_argument("--commit_batch_ops")
+      .help("stop waiting for more ops once this many are queued, 0 means no limit")
+      .default_value("0");
+
+  program.add_argument("--snapshot_every_ops")
+      .help("snapshot the db and compact the raft log every this many applied ops, 0 turns it off")
+      .default_value(std::to_string(raft::RAFT_SNAPSHOT_EVERY_OPS));
+
+  program.add_argument("--snapshot_chunk_kb")
+      .help("size of the chunks snapshots are sent to followers in")
+      .default_value(std::to_string(raft::RAFT_SNAPSHOT_CHUNK_BYTES / 1024));
+
+  program.add_argument("--max_append_kb")
+      .help("most entry bytes sent to a follower in one append, 0 for no limit")
+      .default_value(std::to_string(raft::RAFT_MAX_APPEND_BYTES / 1024));
+
+  program.add_argument("--read_mode")
+      .help("how the leader serves reads: log, index (ReadIndex) or lease, use the same on all replicas")
+      .default_value("index");
+
+  program.add_argument("--max_clock_drift_pct")
+      .help("clock drift allowance that the read lease is shortened by")
+      .default_value(std::to_string(raft::RAFT_MAX_CLOCK_DRIFT_PCT));
+
+  program.add_argument("--db_cache_mb")
+      .help("leveldb block cache size")
+      .default_value(std::to_string(raft::LevelDBOptions{}.blockCacheBytes >> 20));
+
+  program.add_argument("--db_bloom_bits")
+      .help("leveldb bloom filter bits per key, 0 turns the filter off")
+      .default_value(std::to_string(raft::LevelDBOptions{}.bloomBitsPerKey));
+
+  program.add_argument("--db_write_buffer_mb")
+      .help("leveldb memtable size")
+      .default_value(std::to_string(raft::LevelDBOptions{}.writeBufferBytes >> 20));
+
+  program.add_argument("--db_max_open_files")
+      .help("how many table files leveldb keeps open")
+      .default_value(std::to_string(raft::LevelDBOptions{}.maxOpenFiles));
+
+  program.add_argument("--db_compression")
+      .help("leveldb block compression: snappy or none")
+      .default_value("snappy");
+
+  program.add_argument("--db_sync")
+      .help("sync every leveldb write, not needed as the raft log is synced")
+      .default_value( false )
+      .implicit_value( true );
+
+  program.add_argument("--log_level")
+      .help("least severe messages logged: debug, info, warn, error or off")
+      .default_value("info");
+
+  program.add_argument("--log_file")
+      .help("where logs are written, besides stdout")
+      .default_value("/tmp/logs.unreliable.txt");
+
+  program.add_argument("--log_rate_limit")
+      .help("messages per second let through from any one log statement, 0 means no limit")
+      .default_value(std::to_string(WowLogger::Logger::DefaultRateLimit));
+
+  program.add_argument("--stats_period_s")
+      .help("log all metrics every this many seconds, 0 turns it off")
+      .default_value("60");
+
   program.add_argument("--quicktest")
       .help("generates two ops after startup for a quick test")
       .default_value( false )
@@ -100,6 +195,15 @@ int main(int argc, char **argv)
       std::exit(1);
   }
 
+  WowLogger::Level logLevel;
+  if ( ! WowLogger::parseLevel( program.get<std::string>("--log_level"), logLevel ) ) {
+    std::cerr << "Unknown log level: " << program.get<std::string>("--log_level") << std::endl;
+    std::exit(1);
+  }
+  WowLogger::setLevel( logLevel );
+  WowLogger::setFile( program.get<std::string>("--log_file") );
+  WowLogger::setRateLimit( std::stoi(program.get<std::string>("--log_rate_limit")) );
+
   // parse arguments
   auto config_path = program.get<std::string>("--config");
   auto id = std::stoi(program.get<std::string>("--id"));
@@ -112,6 +216,52 @@ int main(int argc, char **argv)
   auto db_port = std::stoi(program.get<std::string>("--db_port"));
   auto enableQuickTest = program["--quicktest"] == true;
 
+  raft::RaftOptions raftOpts;
+  raftOpts.heartbeatPeriodMs = std::stoi(program.get<std::string>("--heartbeat_ms"));
+  raftOpts.commitWindowUs = std::stoi(program.get<std::string>("--commit_window_us"));
+  raftOpts.commitBatchOps = std::stoi(program.get<std::string>("--commit_batch_ops"));
+  raftOpts.snapshotEveryOps = std::stoi(program.get<std::string>("--snapshot_every_ops"));
+  raftOpts.snapshotChunkBytes = std::stoi(program.get<std::string>("--snapshot_chunk_kb")) * 1024;
+  raftOpts.maxClockDriftPct = std::stoi(program.get<std::string>("--max_clock_drift_pct"));
+  raftOpts.maxAppendBytes = std::stoi(program.get<std::string>("--max_append_kb")) * 1024;
+  raftOpts.electionTimeoutMinMs = std::stoi(program.get<std::string>("--election_timeout_min_ms"));
+  raftOpts.electionTimeoutMaxMs = std::stoi(program.get<std::string>("--election_timeout_max_ms"));
+  raftOpts.preVote = program["--no_prevote"] == false;
+  raftOpts.checkQuorum = program["--no_check_quorum"] == false;
+  if ( raftOpts.electionTimeoutMinMs <= 0 || raftOpts.electionTimeoutMaxMs < raftOpts.electionTimeoutMinMs ) {
+    std::cerr << "Election timeouts need 0 < min <= max" << std::endl;
+    std::exit(1);
+  }
+
+  auto readMode = program.get<std::string>("--read_mode");
+  if ( readMode == "log" ) {
+    raftOpts.readMode = raft::ReadMode::Log;
+  } else if ( readMode == "index" ) {
+    raftOpts.readMode = raft::ReadMode::ReadIndex;
+  } else if ( readMode == "lease" ) {
+    raftOpts.readMode = raft::ReadMode::Lease;
+  } else {
+    std::cerr << "Unknown read mode: " << readMode << std::endl;
+    std::exit(1);
+  }
+
+  raft::LevelDBOptions dbOpts;
+  dbOpts.blockCacheBytes = std::stoul(program.get<std::string>("--db_cache_mb")) << 20;
+  dbOpts.bloomBitsPerKey = std::stoi(program.get<std::string>("--db_bloom_bits"));
+  dbOpts.writeBufferBytes = std::stoul(program.get<std::string>("--db_write_buffer_mb")) << 20;
+  dbOpts.maxOpenFiles = std::stoi(program.get<std::string>("--db_max_open_files"));
+  dbOpts.syncWrites = program["--db_sync"] == true;
+
+  auto compression = program.get<std::string>("--db_compression");
+  if ( compression == "snappy" ) {
+    dbOpts.compression = true;
+  } else if ( compression == "none" ) {
+    dbOpts.compression = false;
+  } else {
+    std::cerr << "Unknown compression: " << compression << std::endl;
+    std::exit(1);
+  }
+
   auto servers = ParseConfig(config_path);
 
   auto printServer = [&]( std::string tag, auto&& id ) {
@@ -123,18 +273,31 @@ int main(int argc, char **argv)
   };
 
 
+  ReplicaManager::Instance().setRaftOptions( raftOpts );
+  ReplicaManager::Instance().setShards( std::stoi(program.get<std::string>("--shards")) );
+  ReplicaManager::Instance().setDBOptions( dbOpts );
+  ReplicaManager::Instance().setStatsPeriod( std::stoi(program.get<std::string>("--stats_period_s")) );
+
+  bool started;
   if ( ! isAddedNode ) {
     printServer("ServerDetails", id);
-    ReplicaManager::Instance().initialiseServices(
+    started = ReplicaManager::Instance().initialiseServices(
         servers, id, true, db_path, enableBootstrap, store_dir);
   } else {
-    ReplicaManager::Instance().initialiseServices(
+    started = ReplicaManager::Instance().initialiseServices(
       servers, id, false, db_path, enableBootstrap, store_dir,
       ip, raft_port, db_port );  
   }
+  if ( ! started ) {
+    std::cerr << "Could not open the store, see the log" << std::endl;
+    std::exit(1);
+  }
   
   // start up the replica
-  ReplicaManager::Instance().start();
+  if ( ! ReplicaManager::Instance().start() ) {
+    std::cerr << "Could not load the local log or snapshot, see the log" << std::endl;
+    std::exit(1);
+  }
 
   std::this_thread::sleep_for(std::chrono::seconds(5));
 
@@ -6,6 +6,8 @@
 #include "ConsensusUtils.H"
 #include "PersistentStore.H"
 #include "PersistentVector.H"
+#include "SegmentedLog.H"
+#include "LogCodec.H"
 
 using namespace raft;
 
@@ -20,6 +22,10 @@ int main( int argc, char** argv) {
     .default_value( false )
     .implicit_value( true );
 
+  program.add_argument("--wal")
+    .help("the provided file is a segmented log prefix, like raft.1.wal")
+    .default_value( false )
+    .implicit_value( true );
 
   try {
       program.parse_args( argc, argv );
@@ -32,17 +38,34 @@ int main( int argc, char** argv) {
   
   auto filename = program.get<std::string>( "--file" );
   auto isVec = program["--vec"] == true;
+  auto isWal = program["--wal"] == true;
 
   LogInfo("Reading File=" + filename + " "
-          + " IsPersistentVector=" + std::to_string(isVec) );
+          + " IsPersistentVector=" + std::to_string(isVec)
+          + " IsSegmentedLog=" + std::to_string(isWal) );
 
-  if ( isVec ) {
-    PersistentVector<LogEntry> pVec;
+  if ( isWal ) {
+    // segments in an older record format are upgraded here, like a
+    // replica would on startup
+    SegmentedLog<LogEntry, LogEntryCodec> wal;
+    if ( ! wal.setup( filename, true ) ) {
+      LogError("Log could not be read. File corrupted?");
+      return 1;
+    }
+    LogInfo("RecordFormat=" + std::to_string(LogEntryCodec::Version)
+            + " FirstIndex=" + std::to_string(wal.firstIndex())
+            + " NumItems=" + std::to_string(wal.size()) );
+    for ( size_t i = 0; i < wal.size(); ++i ) {
+      std::cout << "[" << i << "]\t" <<
+        wal[i].str() << std::endl;
+    }
+  } else if ( isVec ) {
+    PersistentVector<LogEntryImage> pVec;
     pVec.setup( filename, true );
     auto cntr = 0;
     for ( const auto& entry: pVec ) {
       std::cout << "[" << cntr++ << "]\t" <<  
-        entry.str() << std::endl;
+        LogEntryCodec::fromLegacy( entry ).str() << std::endl;
     }
   } else {
     auto valOpt = PersistentStore::loadInt( filename );
@@ -7,7 +7,8 @@
 #include "ConsensusUtils.H"
 #include "OhMyConfig.H"
 #include "PersistentStore.H"
-#include "PersistentVector.H"
+#include "SegmentedLog.H"
+#include "LogCodec.H"
 
 using namespace raft;
 
@@ -34,6 +35,10 @@ int main( int argc, char** argv ) {
     .required()
     .help("ReplicaId for which the store is being generated");
 
+  program.add_argument( "--format" )
+    .default_value( std::to_string( LogEntryCodec::Version ) )
+    .help("log record format version to write, older ones get upgraded on bootstrap");
+
   try {
       program.parse_args( argc, argv );
   }
@@ -50,6 +55,7 @@ int main( int argc, char** argv ) {
   auto id = getInt( "--id" );
   auto votedFor = getInt( "--votedfor" );
   auto currentTerm = getInt( "--currentterm" );
+  auto format = getInt( "--format" );
   auto inputFile = program.get<std::string>( "--input" );
   auto outputDir = program.get<std::string>( "--outputdir" ) + '/';
 
@@ -63,32 +69,45 @@ int main( int argc, char** argv ) {
   }
 
   auto storePrefix = outputDir + "raft." + std::to_string(id) + ".";
-  auto logFilename = storePrefix + "log.persist";
-
-  PersistentVector<LogEntry> pVec;
-  pVec.setup( logFilename, false,
-     []( auto&& e ) { e.op = e.op.withoutPromise(); return e; } );
-
-  for ( auto row: parsedInp.tokensByRow ) {
-    auto term = std::stoi(row[parsedInp.header["term"]]);
-    auto count = std::stoi(row[parsedInp.header["count"]]); 
-    while ( count-- ) {
-      auto kind = rand() % 2 ? RaftOp::GET : RaftOp::PUT;
-      pVec.push_back( LogEntry {
-        .term = term,
-        .op = RaftOp {
-          .kind = kind,
-          .args = kind == RaftOp::GET
-                ? RaftOp::arg_t( rand()%100 )
-                : RaftOp::arg_t( std::make_pair( rand()%100, rand()%100 ) ),
-          .promiseHandle = {}
-        }
-      });
+  auto logFilename = storePrefix + "wal";
+
+  auto writeLog = [&]( auto& pVec ) {
+    pVec.setup( logFilename, false,
+       []( auto&& e ) { e.op = e.op.withoutPromise(); return e; } );
+
+    for ( auto row: parsedInp.tokensByRow ) {
+      auto term = std::stoi(row[parsedInp.header["term"]]);
+      auto count = std::stoi(row[parsedInp.header["count"]]); 
+      while ( count-- ) {
+        auto kind = rand() % 2 ? RaftOp::GET : RaftOp::PUT;
+        pVec.push_back( LogEntry {
+          .term = term,
+          .op = RaftOp {
+            .kind = kind,
+            .args = kind == RaftOp::GET
+                  ? RaftOp::arg_t( rand()%100 )
+                  : RaftOp::arg_t( std::make_pair( rand()%100, rand()%100 ) ),
+            .promiseHandle = {}
+          }
+        });
+      }
     }
+    pVec.persist();
+    LogInfo("Wrote NumItems=" + std::to_string(pVec.size())
+            + " Format=" + std::to_string(format)
+            + " Location=" + logFilename );
+  };
+
+  if ( format == LogEntryImageCodec::Version ) {
+    SegmentedLog<LogEntry, LogEntryImageCodec> pVec;
+    writeLog( pVec );
+  } else if ( format == LogEntryCodec::Version ) {
+    SegmentedLog<LogEntry, LogEntryCodec> pVec;
+    writeLog( pVec );
+  } else {
+    LogError("Unknown log record format " + std::to_string(format));
+    return 1;
   }
-  pVec.persist();
-  LogInfo("Wrote NumItems=" + std::to_string(pVec.size())
-          + " Location=" + logFilename );
 
   PersistentStore pStore;
   pStore.setup( storePrefix );
@@ -179,6 +179,22 @@ def graphNet(data):
 
 
 
+def parseBenchCsv(inFile):
+	data = pd.read_csv(inFile)
+	data["run"] = os.path.basename(inFile)
+	return data
+
+# Plots ohmybench runs against each other, one line per csv file
+def graphBench(inFiles):
+	combined = pd.concat([parseBenchCsv(f) for f in inFiles], ignore_index=True)
+	graphData(combined, "run", "time_s", "ops_per_s", "Time (s)", "Throughput (ops/s)", "Throughput")
+	for op in ["read", "write"]:
+		for p in ["p50", "p99", "p999"]:
+			field = op + "_" + p + "_us"
+			if combined[op + "_ops"].sum() > 0:
+				graphData(combined, "run", "time_s", field, "Time (s)", "Latency (us)", op.capitalize() + " " + p)
+
+
 def main(inFile):
 
 	NextNodeID = 0
@@ -223,4 +239,7 @@ def main(inFile):
 
 
 if __name__ == "__main__":
-	main(sys.argv[1])
+	if sys.argv[1] == "--bench":
+		graphBench(sys.argv[2:])
+	else:
+		main(sys.argv[1])
@@ -0,0 +1,85 @@
+import subprocess as sp
+import argparse
+import glob
+import os
+import shutil
+import struct
+import sys
+import logging
+
+# Writes the same logs once in the old record format (1) and once in the
+# current one (2), reads both back through readstore, which upgrades the
+# old segments like a replica does on startup, and checks that they read
+# the same and that the old segments were rewritten. writestore picks the
+# ops with an unseeded rand(), so both runs write the same entries.
+
+OLD_FORMAT = 1
+NEW_FORMAT = 2
+
+WRITESTORE = '{0}/writestore --id {1} --outputdir {2} --input {3}/rep{1}.csv --format {4}'
+READSTORE = '{0}/readstore --wal --file {1}/raft.{2}.wal'
+
+
+def readEntries(binBasePath, storeDir, repId):
+    CMD = READSTORE.format(binBasePath, storeDir, repId)
+    result = sp.run(CMD, shell=True, stdout=sp.PIPE, text=True, check=True)
+    return [ x.strip() for x in result.stdout.split('\n') if 'LogEntry' in x ]
+
+
+def segmentVersions(storeDir, repId):
+    versions = []
+    for path in sorted(glob.glob('{}/raft.{}.wal.*'.format(storeDir, repId))):
+        with open(path, 'rb') as seg:
+            magic, version = struct.unpack('<II', seg.read(8))
+            versions.append(version)
+    return versions
+
+
+def main():
+    logging.basicConfig(level=logging.INFO)
+
+    parser = argparse.ArgumentParser(description='I check that old log segments get upgraded')
+    parser.add_argument('--code', default='correctness_1', help='which test\'s repX.csv to use? eg. correctness_1')
+    args = parser.parse_args()
+
+    binBasePath     = os.path.join(os.environ['PROJ_HOME'], 'build', 'bin')
+    testBasePath    = os.path.join(os.environ['PROJ_HOME'], 'tests', args.code)
+    testTmpPath     = os.path.join(testBasePath, 'tmp_upgrade')
+    oldPath         = os.path.join(testTmpPath, 'v{}'.format(OLD_FORMAT))
+    newPath         = os.path.join(testTmpPath, 'v{}'.format(NEW_FORMAT))
+
+    repIds = sorted(int(os.path.basename(x)[3:-4]) for x in glob.glob(os.path.join(testBasePath, 'rep*.csv')))
+    logging.info('Discovered NumReplicas={}'.format(len(repIds)))
+
+    failed = False
+    for repId in repIds:
+        for path, fmt in [(oldPath, OLD_FORMAT), (newPath, NEW_FORMAT)]:
+            shutil.rmtree(path, ignore_errors=True)
+            os.makedirs(path)
+            sp.check_call(WRITESTORE.format(binBasePath, repId, path, testBasePath, fmt), shell=True)
+
+        if segmentVersions(oldPath, repId) != [OLD_FORMAT]:
+            logging.error('Store not written in format {} RepId={}'.format(OLD_FORMAT, repId))
+            failed = True
+            continue
+
+        expected = readEntries(binBasePath, newPath, repId)
+        upgraded = readEntries(binBasePath, oldPath, repId)
+        # a second read finds the segments already upgraded
+        reread = readEntries(binBasePath, oldPath, repId)
+
+        if not expected or upgraded != expected or reread != expected:
+            logging.error('Log Mismatched after upgrade RepId={}'.format(repId))
+            failed = True
+        elif segmentVersions(oldPath, repId) != [NEW_FORMAT]:
+            logging.error('Segments not rewritten RepId={} Versions={}'.format(repId, segmentVersions(oldPath, repId)))
+            failed = True
+        else:
+            logging.info('Upgrade OK RepId={} NumItems={}'.format(repId, len(expected)))
+
+    shutil.rmtree(testTmpPath, ignore_errors=True)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()